@@ -3,28 +3,138 @@
 #include "driver/gpio.h"
 #include "driver/i2c_master.h"
 #include "string.h"
+#include "sdkconfig.h"
 
 #ifdef __cplusplus
 extern C {
 #endif
 
+typedef enum {
+    OLED_FONT_5X8,
+    OLED_FONT_6X8,
+    OLED_FONT_8X8,
+} oled_font_t;
+
+#define OLED_CMD_BATCH_SIZE 16
+
+typedef struct {
+    uint8_t len;
+    uint8_t buf[OLED_CMD_BATCH_SIZE + 1];
+} oled_cmd_batch_t;
+
 i2c_master_bus_config_t oled_init_i2c(void);
 void oled_init(i2c_master_bus_handle_t i2c_bus_handle);
+void oled_init_splash(i2c_master_bus_handle_t i2c_bus_handle, const uint8_t *splash);
+int64_t oled_get_first_frame_time_us(void);
+void oled_cmd_begin(oled_cmd_batch_t *batch);
+bool oled_cmd_add(oled_cmd_batch_t *batch, uint8_t cmd);
+void oled_cmd_commit(oled_cmd_batch_t *batch);
+bool oled_cmd_position(oled_cmd_batch_t *batch, uint8_t x, uint8_t y);
+bool oled_cmd_contrast(oled_cmd_batch_t *batch, uint8_t contrast);
+bool oled_cmd_invert(oled_cmd_batch_t *batch, bool invert);
+bool oled_cmd_flip(oled_cmd_batch_t *batch, bool x_flip, bool y_flip);
+bool oled_cmd_display(oled_cmd_batch_t *batch, bool on);
 void oled_set_position(uint8_t x, uint8_t y);
+void oled_set_contrast(uint8_t contrast);
+void oled_set_invert(bool invert);
+void oled_set_flip(bool x_flip, bool y_flip);
+void oled_set_display(bool on);
+void oled_direct_print(oled_font_t font, uint8_t x, uint8_t page, const char *text);
+void oled_direct_draw_bmp(uint8_t x, uint8_t page, uint8_t w, uint8_t pages, const uint8_t *bitmap);
+void oled_direct_clear(void);
+
+// the framebuffer, drawing, scheduler and queue API, left out with CONFIG_OLED_FRAMEBUFFER=n
+#ifdef CONFIG_OLED_FRAMEBUFFER
+
+typedef enum {
+    OLED_ROTATION_0,
+    OLED_ROTATION_90,
+    OLED_ROTATION_180,
+    OLED_ROTATION_270,
+} oled_rotation_t;
+
+#define OLED_NUM_MAX_WIDTH  11      // enough for -2147483648
+#define OLED_NUM_ZERO_PAD   0x01    // fill numeric fields with leading zeros
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    uint8_t width;
+    oled_font_t font;
+    uint8_t flags;
+    char last[OLED_NUM_MAX_WIDTH];
+} oled_num_field_t;
+
+typedef struct {
+    uint8_t x;          // left column of the plot
+    uint8_t page;       // top page of the plot
+    uint8_t width;      // columns of the plot, one sample each
+    uint8_t pages;      // height of the plot in pages
+    int16_t min;        // sample value drawn at the bottom
+    int16_t max;        // sample value drawn at the top
+    int16_t *samples;   // ring buffer of width samples, owned by the caller
+    uint8_t head;       // where the next sample is stored
+    uint8_t count;      // samples stored
+} oled_chart_t;
+
+// viewport and clip a queued command is drawn in, a clip of 0x0 clips to the whole viewport
+typedef struct {
+    int16_t x;              // left of the viewport on the screen
+    int16_t y;              // top of the viewport on the screen
+    int16_t width;          // width of the viewport
+    int16_t height;         // height of the viewport
+    int16_t clip_x;         // left of the clip rectangle in the viewport
+    int16_t clip_y;         // top of the clip rectangle in the viewport
+    int16_t clip_width;     // width of the clip rectangle
+    int16_t clip_height;    // height of the clip rectangle
+} oled_view_t;
+
+void oled_set_rotation(oled_rotation_t rotation);
+int16_t oled_get_width(void);
+int16_t oled_get_height(void);
+void oled_set_viewport(int16_t x, int16_t y, int16_t width, int16_t height);
+void oled_reset_viewport(void);
+void oled_set_clip(int16_t x, int16_t y, int16_t width, int16_t height);
+void oled_reset_clip(void);
 void oled_flush(void);
+void oled_flush_dirty(void);
+void oled_mark_dirty(int16_t x, int16_t y, int16_t width, int16_t height);
 void oled_clear_buffer(void);
 void oled_clear(void);
+void oled_start_flush_scheduler(uint32_t frame_period_ms);
+void oled_request_flush(void);
+void oled_request_flush_now(void);
+void oled_request_flush_dirty(void);
+bool oled_queue_print(const oled_view_t *view, oled_font_t font, int16_t x, int16_t y, const char *text);
+bool oled_queue_bmp(const oled_view_t *view, int16_t x, int16_t y, int16_t w, int16_t h, const uint8_t *bitmap);
+bool oled_queue_fill_rect(const oled_view_t *view, int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color);
+bool oled_queue_clear(void);
+bool oled_queue_rotation(oled_rotation_t rotation);
+bool oled_queue_commands(const oled_cmd_batch_t *batch);
 void oled_set_pixel(int16_t x, int16_t y, uint8_t color);
 void oled_draw_bmp(int16_t x, int16_t y, int16_t w, int16_t h, const uint8_t *bitmap);
-void oled_draw_char8x8(uint8_t x, uint8_t y, char c);
-void oled_print_8x8(uint8_t x, uint8_t y, const char *text);
-void oled_draw_char6x8(uint8_t x, uint8_t y, char c);
-void oled_print_6x8(uint8_t x, uint8_t y, const char *text);
-void oled_draw_char5x8(uint8_t x, uint8_t y, char c);
-void oled_print_5x8(uint8_t x, uint8_t y, const char *text);
-void oled_draw_hline(uint8_t x, uint8_t y, uint8_t length, uint8_t color);
-void oled_draw_vline(uint8_t x, uint8_t y, uint8_t length, uint8_t color);
-void oled_draw_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t color);
+void oled_draw_char8x8(int16_t x, int16_t y, char c);
+void oled_print_8x8(int16_t x, int16_t y, const char *text);
+void oled_draw_char6x8(int16_t x, int16_t y, char c);
+void oled_print_6x8(int16_t x, int16_t y, const char *text);
+void oled_draw_char5x8(int16_t x, int16_t y, char c);
+void oled_print_5x8(int16_t x, int16_t y, const char *text);
+void oled_print_8x8_scaled(int16_t x, int16_t y, const char *text, uint8_t scale);
+void oled_print_6x8_scaled(int16_t x, int16_t y, const char *text, uint8_t scale);
+void oled_print_5x8_scaled(int16_t x, int16_t y, const char *text, uint8_t scale);
+void oled_num_field_init(oled_num_field_t *field, int16_t x, int16_t y, uint8_t width, oled_font_t font, uint8_t flags);
+void oled_print_int(oled_num_field_t *field, int32_t value);
+void oled_print_fixed(oled_num_field_t *field, int32_t value, uint8_t decimals);
+void oled_draw_hline(int16_t x, int16_t y, int16_t length, uint8_t color);
+void oled_draw_vline(int16_t x, int16_t y, int16_t length, uint8_t color);
+void oled_draw_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color);
+void oled_fill_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color);
+void oled_chart_init(oled_chart_t *chart, uint8_t x, uint8_t page, uint8_t width, uint8_t pages,
+                     int16_t min, int16_t max, int16_t *samples);
+void oled_chart_push(oled_chart_t *chart, int16_t sample);
+void oled_chart_redraw(oled_chart_t *chart);
+
+#endif
 
 #ifdef __cplusplus
 extern C }
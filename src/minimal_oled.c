@@ -1,5 +1,15 @@
 #include "minimal_oled.h"
 #include "fonts.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdatomic.h>
+#include "esp_timer.h"
+#include "esp_idf_version.h"
+
+// the boot frame is sent in place with i2c_master_multi_buffer_transmit()
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 4, 0)
+#error "minimal_oled needs ESP-IDF v5.4 or newer (i2c_master_multi_buffer_transmit)"
+#endif
 
 // I2C frequency
 #define I2C_MASTER_FREQ_HZ 400000
@@ -7,10 +17,24 @@
 // Maximun ticks to wait after send
 #define I2C_TICKS_TO_WAIT 100
 
+// flush scheduler definitions
+#define OLED_SCHED_STACK_SIZE   2048    // stack of the scheduler task
+#define OLED_SCHED_PRIORITY     5       // priority of the scheduler task
+#define OLED_SCHED_REQUEST      0x01    // notification bit: flush on the next frame slot
+#define OLED_SCHED_URGENT       0x02    // notification bit: flush right away
+#define OLED_SCHED_DRAW         0x04    // notification bit: draw commands queued
+#define OLED_SCHED_DIRTY        0x08    // notification bit: flush the changed columns on the next frame slot
+
+// draw command queue definitions
+#define OLED_QUEUE_LENGTH       16      // slots in the draw queue (power of 2)
+#define OLED_QUEUE_MASK         (OLED_QUEUE_LENGTH - 1)
+#define OLED_QUEUE_TEXT_LEN     21      // max characters of a queued text (128 / 6)
+
 // oled definitions
 #define OLED_ADDR         0x3C    // oled write address (0x3C << 1)
 #define OLED_CMD_MODE     0x00    // set command mode
 #define OLED_DAT_MODE     0x40    // set data mode
+#define OLED_CMD_SINGLE   0x80    // one command byte follows, then another control byte
 
 // oled commands
 #define OLED_COLUMN_LOW   0x00    // set lower 4 bits of start column (0x00 - 0x0F)
@@ -55,14 +79,14 @@
 #ifndef CONFIG_CHIP_SH1106
 static const uint8_t SSD1306_128X64_INIT_CMD[] = {
     OLED_CMD_MODE,
+    OLED_DISPLAY_OFF,                       // display off until the first frame is loaded
     OLED_MULTIPLEX,   0x3F,                 // set multiplex ratio  
     OLED_CHARGEPUMP,  0x14,                 // set DC-DC enable  
     OLED_MEMORYMODE,  0x00,                 // set horizontal addressing mode
     OLED_COLUMNS,     0x00, 0x7F,           // set start and end column
-    OLED_PAGES,       0x00, 0x3F,           // set start and end page
+    OLED_PAGES,       0x00, 0x07,           // set start and end page (8 pages)
     OLED_COMPINS,     0x12,                 // set com pins
-    OLED_XFLIP, OLED_YFLIP,                 // flip screen
-    OLED_DISPLAY_ON                         // display on
+    OLED_XFLIP, OLED_YFLIP                  // flip screen
 };
 #endif
 
@@ -85,8 +109,7 @@ static const uint8_t SH1106_128X64_INIT_CMD[] = {
     OLED_COLUMN_LOW,  0x00,                 // 0x00 - set lower column address for page addressing mode
     OLED_COLUMN_HIGH, 0x10,                 // 0x10 - set higher column address for page addressing mode
     OLED_SCROLL_OFF,                        // 0x2E - deactivate scroll
-    OLED_INVERT_OFF,                        // 0xA6 - set normal display (not inverted)
-    OLED_DISPLAY_ON                         // 0xAF - display on
+    OLED_INVERT_OFF                         // 0xA6 - set normal display (not inverted)
 };
 #endif
 
@@ -97,27 +120,164 @@ static const uint8_t SH1106_128X64_INIT_CMD[] = {
 // SSD1306 initialisation sequence for 128x32 (SH1106 doesn't support 128x32)
 static const uint8_t SSD1306_128X32_INIT_CMD[] = {
     OLED_CMD_MODE,
+    OLED_DISPLAY_OFF,                       // display off until the first frame is loaded
     OLED_MULTIPLEX,   0x1F,                 // set multiplex ratio  
     OLED_CHARGEPUMP,  0x14,                 // set DC-DC enable  
     OLED_MEMORYMODE,  0x00,                 // set horizontal addressing mode
     OLED_COLUMNS,     0x00, 0x7F,           // set start and end column
-    OLED_PAGES,       0x00, 0x1F,           // set start and end page
+    OLED_PAGES,       0x00, 0x03,           // set start and end page (4 pages)
     OLED_COMPINS,     0x02,                 // set com pins
-    OLED_XFLIP, OLED_YFLIP,                 // flip screen
-    OLED_DISPLAY_ON                         // display on
+    OLED_XFLIP, OLED_YFLIP                  // flip screen
 };
 
 #endif
 
+// init sequence of the configured chip and resolution, it leaves the display off
+#ifdef CONFIG_RESOLUTION_128X64
+    #ifdef CONFIG_CHIP_SH1106
+        #define OLED_INIT_CMD SH1106_128X64_INIT_CMD
+    #else
+        #define OLED_INIT_CMD SSD1306_128X64_INIT_CMD
+    #endif
+#else
+    #define OLED_INIT_CMD SSD1306_128X32_INIT_CMD
+#endif
+
 #define OLED_WIDTH 128
 #define OLED_NUM_PAGES (OLED_HEIGHT / 8)
 
-// Buffer for the oled
-uint8_t oled_buf[OLED_NUM_PAGES][OLED_WIDTH];
+// longest position header of a direct write (SSD1306 window commands + data mode)
+#define OLED_DIRECT_HEADER_MAX 13
 
 // handle to send the buffer;
 i2c_master_dev_handle_t i2c_dev_handle;
 
+#ifndef CONFIG_CHIP_SH1106
+// false after a partial flush left the SSD1306 address window smaller than the screen
+static bool oled_window_full = true;
+#endif
+
+// a blank page in flash, to clear the display without a buffer
+static const uint8_t oled_blank_page[OLED_WIDTH] = {0};
+
+// time since the app started when the display was turned on with its first frame
+static int64_t oled_first_frame_us = 0;
+
+#ifdef CONFIG_OLED_FRAMEBUFFER
+
+// Buffer for the oled
+uint8_t oled_buf[OLED_NUM_PAGES][OLED_WIDTH];
+
+// rotation applied to the drawing functions, and the size of the rotated screen
+static oled_rotation_t oled_rotation = OLED_ROTATION_0;
+static int16_t oled_width = OLED_WIDTH;
+static int16_t oled_height = OLED_HEIGHT;
+
+// viewport and clip rectangle on the rotated screen, right and bottom are exclusive
+static int16_t oled_origin_x = 0;
+static int16_t oled_origin_y = 0;
+static int16_t oled_view_left = 0;
+static int16_t oled_view_top = 0;
+static int16_t oled_view_right = OLED_WIDTH;
+static int16_t oled_view_bottom = OLED_HEIGHT;
+static int16_t oled_clip_left = 0;
+static int16_t oled_clip_top = 0;
+static int16_t oled_clip_right = OLED_WIDTH;
+static int16_t oled_clip_bottom = OLED_HEIGHT;
+
+// columns of every page changed since the last flush, clean when first > last
+static uint8_t oled_dirty_first[OLED_NUM_PAGES] = { [0 ... OLED_NUM_PAGES - 1] = 0xFF };
+static uint8_t oled_dirty_last[OLED_NUM_PAGES] = {0};
+
+// task that owns the flushes when the scheduler is running
+static TaskHandle_t oled_sched_task = NULL;
+
+// minimum time between two scheduled flushes
+static TickType_t oled_frame_period = 0;
+
+// types of the queued draw commands
+typedef enum {
+    OLED_DRAW_PRINT,
+    OLED_DRAW_BMP,
+    OLED_DRAW_FILL,
+    OLED_DRAW_CLEAR,
+    OLED_DRAW_COMMANDS,
+    OLED_DRAW_ROTATION,
+} oled_draw_type_t;
+
+// a queued draw command, copied by value so producers keep nothing alive but bitmaps.
+// The view travels with the command, the drain never uses the viewport of another task
+typedef struct {
+    uint8_t type;
+    int16_t x;
+    int16_t y;
+    oled_view_t view;
+    union {
+        struct { uint8_t font; char text[OLED_QUEUE_TEXT_LEN + 1]; } print;
+        struct { int16_t w; int16_t h; const uint8_t *bitmap; } bmp;
+        struct { int16_t w; int16_t h; uint8_t color; } fill;
+        oled_cmd_batch_t commands;
+        uint8_t rotation;
+    };
+} oled_draw_cmd_t;
+
+// slot of the draw queue, seq tells whether the slot is free or holds a command
+typedef struct {
+    atomic_uint seq;
+    oled_draw_cmd_t cmd;
+} oled_queue_slot_t;
+
+// bounded multi-producer queue, only the scheduler task consumes it
+static oled_queue_slot_t oled_queue[OLED_QUEUE_LENGTH];
+static atomic_uint oled_queue_tail = 0;
+static unsigned int oled_queue_head = 0;
+static atomic_bool oled_queue_ready = false;
+
+#endif
+
+/**
+ * @fn oled_direct_header
+ *
+ * @brief Write the position commands of a direct write, each with its own control
+ * byte, and switch to data mode so position and data go in one transaction
+ *
+ * @param buffer where the header is written, OLED_DIRECT_HEADER_MAX bytes
+ * @param x first column to write
+ * @param page page to write
+ * @param count number of columns that will follow
+ *
+ * @return size of the header
+ */
+static uint8_t oled_direct_header(uint8_t *buffer, uint8_t x, uint8_t page, uint8_t count)
+{
+    uint8_t len = 0;
+
+#ifdef CONFIG_CHIP_SH1106
+    // SH1106 needs offset of +2 columns (has 132 column buffer but only displays 128)
+    uint8_t column = x + 2;
+    const uint8_t cmds[] = {
+        OLED_PAGE | page,
+        OLED_COLUMN_LOW | (column & 0x0F),
+        OLED_COLUMN_HIGH | ((column >> 4) & 0x0F),
+    };
+#else
+    const uint8_t cmds[] = {
+        OLED_COLUMNS, x, x + count - 1,
+        OLED_PAGES, page, page,
+    };
+    oled_window_full = false;
+#endif
+
+    for (uint8_t i = 0; i < sizeof(cmds); i++)
+    {
+        buffer[len++] = OLED_CMD_SINGLE;
+        buffer[len++] = cmds[i];
+    }
+    buffer[len++] = OLED_DAT_MODE;
+
+    return len;
+}
+
 /**
  * @fn oled_init_i2c
  * 
@@ -135,14 +295,7 @@ i2c_master_bus_config_t oled_init_i2c(void){
 	i2c_master_bus_handle_t i2c_bus_handle;
 	ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_mst_config, &i2c_bus_handle));
 
-	i2c_device_config_t dev_cfg = {
-		.dev_addr_length = I2C_ADDR_BIT_LEN_7,
-		.device_address = OLED_ADDR,
-		.scl_speed_hz = I2C_MASTER_FREQ_HZ,
-	};
-
-	ESP_ERROR_CHECK(i2c_master_bus_add_device(i2c_bus_handle, &dev_cfg, &i2c_dev_handle));
-
+    // oled_init() adds the device to the bus
     oled_init(i2c_bus_handle);
 
     return i2c_mst_config;
@@ -151,13 +304,28 @@ i2c_master_bus_config_t oled_init_i2c(void){
 /**
  * @fn oled_init
  * 
- * @brief Init the oled with the address and device, this function needs an i2c bus initialized
+ * @brief Init the oled with the address and device, this function needs an i2c bus initialized.
+ * The display is turned on already blank
  * 
  * @param i2c_bus_handle Bus for the i2c master
  */
 void oled_init(i2c_master_bus_handle_t i2c_bus_handle)
 {
+    oled_init_splash(i2c_bus_handle, NULL);
+}
 
+/**
+ * @fn oled_init_splash
+ * 
+ * @brief Init the oled and show a first frame. The display stays off while the
+ * init sequence and the frame are sent, so no random RAM content is ever shown.
+ * On SSD1306 the init sequence and the whole frame go in a single transaction
+ * 
+ * @param i2c_bus_handle Bus for the i2c master
+ * @param splash full frame to show (128 bytes per page, can be in flash), NULL for a blank screen
+ */
+void oled_init_splash(i2c_master_bus_handle_t i2c_bus_handle, const uint8_t *splash)
+{
     // First define the device and frequency
     i2c_device_config_t dev_cfg = {
 		.dev_addr_length = I2C_ADDR_BIT_LEN_7,
@@ -167,337 +335,1920 @@ void oled_init(i2c_master_bus_handle_t i2c_bus_handle)
 
 	ESP_ERROR_CHECK(i2c_master_bus_add_device(i2c_bus_handle, &dev_cfg, &i2c_dev_handle));
 
-    // Init oled based on chip type and resolution
-#ifdef CONFIG_RESOLUTION_128X64
-    #ifdef CONFIG_CHIP_SH1106
-        // SH1106 128x64 initialization
-        i2c_master_transmit(i2c_dev_handle, SH1106_128X64_INIT_CMD, sizeof(SH1106_128X64_INIT_CMD), I2C_TICKS_TO_WAIT);
-    #else
-        // SSD1306 128x64 initialization
-        i2c_master_transmit(i2c_dev_handle, SSD1306_128X64_INIT_CMD, sizeof(SSD1306_128X64_INIT_CMD), I2C_TICKS_TO_WAIT);
-    #endif
+    // The frame is sent from where it is, a blank frame repeats the blank page
+    i2c_master_transmit_multi_buffer_info_t parts[OLED_NUM_PAGES + 1];
+
+#ifdef CONFIG_CHIP_SH1106
+    // SH1106 only has page addressing: init sequence, then position and data of every page
+    i2c_master_transmit(i2c_dev_handle, OLED_INIT_CMD, sizeof(OLED_INIT_CMD), I2C_TICKS_TO_WAIT);
+
+    for (uint8_t p = 0; p < OLED_NUM_PAGES; p++)
+    {
+        uint8_t header[OLED_DIRECT_HEADER_MAX];
+
+        parts[0].write_buffer = header;
+        parts[0].buffer_size = oled_direct_header(header, 0, p, OLED_WIDTH);
+        parts[1].write_buffer = (uint8_t *)(splash ? &splash[p * OLED_WIDTH] : oled_blank_page);
+        parts[1].buffer_size = OLED_WIDTH;
+        i2c_master_multi_buffer_transmit(i2c_dev_handle, parts, 2, I2C_TICKS_TO_WAIT);
+    }
 #else
-    // SSD1306 128x32 initialization (SH1106 doesn't support 128x32)
-    i2c_master_transmit(i2c_dev_handle, SSD1306_128X32_INIT_CMD, sizeof(SSD1306_128X32_INIT_CMD), I2C_TICKS_TO_WAIT);
-#endif
-    
-}
+    // SSD1306: every init command with its own control byte, then the frame in data mode
+    uint8_t header[2 * sizeof(OLED_INIT_CMD)];
+    uint8_t len = 0;
+    size_t count = 1;
 
-/**
- * @fn oled_set_position
- * 
- * @brief This function sets the position on the oled
- * 
- * @param x set position on x
- * 
- * @param y set position on y
- */
-void oled_set_position(uint8_t x, uint8_t y) 
-{
-    uint8_t oled_buffer[5] = {0};
-    uint8_t buffer_position = 0;
-    uint8_t column = x;
+    for (uint8_t i = 1; i < sizeof(OLED_INIT_CMD); i++)
+    {
+        header[len++] = OLED_CMD_SINGLE;
+        header[len++] = OLED_INIT_CMD[i];
+    }
+    header[len++] = OLED_DAT_MODE;
 
-#ifdef CONFIG_CHIP_SH1106
-    // SH1106 needs offset of +2 columns (has 132 column buffer but only displays 128)
-    column += 2;
+    parts[0].write_buffer = header;
+    parts[0].buffer_size = len;
+
+    if (splash)
+    {
+        parts[count].write_buffer = (uint8_t *)splash;
+        parts[count++].buffer_size = OLED_NUM_PAGES * OLED_WIDTH;
+    }
+    else
+    {
+        for (uint8_t p = 0; p < OLED_NUM_PAGES; p++)
+        {
+            parts[count].write_buffer = (uint8_t *)oled_blank_page;
+            parts[count++].buffer_size = OLED_WIDTH;
+        }
+    }
+
+    i2c_master_multi_buffer_transmit(i2c_dev_handle, parts, count, I2C_TICKS_TO_WAIT);
+
+    // The init sequence sets the window to the whole screen
+    oled_window_full = true;
+#endif
+
+#ifdef CONFIG_OLED_FRAMEBUFFER
+    // The buffer starts with the frame on the display
+    if (splash)
+        memcpy(oled_buf, splash, sizeof(oled_buf));
+    else
+        memset(oled_buf, 0x00, sizeof(oled_buf));
 #endif
 
-    oled_buffer[buffer_position++] = OLED_CMD_MODE;
-    oled_buffer[buffer_position++] = OLED_PAGE | y;
-    oled_buffer[buffer_position++] = OLED_COLUMN_LOW | (column & 0x0F);
-    oled_buffer[buffer_position++] = OLED_COLUMN_HIGH | ((column >> 4) & 0x0F);
+    oled_set_display(true);
 
-    i2c_master_transmit(i2c_dev_handle, oled_buffer, buffer_position, I2C_TICKS_TO_WAIT);
+    // esp_timer starts with the app, the ROM and bootloader time is not in it
+    oled_first_frame_us = esp_timer_get_time();
 }
 
 /**
- * @fn oled_flush_page
+ * @fn oled_get_first_frame_time_us
  * 
- * @brief Flush any page from the oled
+ * @brief Time from the start of the app until oled_init_splash() turned the
+ * display on with its first frame, it includes everything done by the app
+ * before, like the bus creation. It is measured with esp_timer, so the time
+ * spent in the ROM and the bootloader before the app started is not counted
  * 
- * @param page number of page to flush
+ * @return time since the app started in microseconds
  */
-static void oled_flush_page(uint8_t page)
+int64_t oled_get_first_frame_time_us(void)
 {
-    if(page >= OLED_NUM_PAGES) return;
-
-#ifdef CONFIG_CHIP_SH1106
-    // SH1106 needs separate command and data transactions (as per example)
-    // First transaction: Set page and column address (offset by +2 columns)
-    uint8_t cmd_buffer[5] = {0};
-    cmd_buffer[0] = OLED_CMD_MODE;
-    cmd_buffer[1] = OLED_PAGE | page;                          // Set page address
-    cmd_buffer[2] = OLED_COLUMN_LOW | 0x02;                    // Set lower column (offset +2)
-    cmd_buffer[3] = OLED_COLUMN_HIGH | 0x00;                   // Set higher column
-    i2c_master_transmit(i2c_dev_handle, cmd_buffer, 4, I2C_TICKS_TO_WAIT);
-    
-    // Second transaction: Send data
-    uint8_t data_buffer[OLED_WIDTH + 1] = {0};
-    data_buffer[0] = OLED_DAT_MODE;
-    for(uint8_t i = 0; i < OLED_WIDTH; i++)
-    {
-        data_buffer[i + 1] = oled_buf[page][i];
-    }
-    i2c_master_transmit(i2c_dev_handle, data_buffer, OLED_WIDTH + 1, I2C_TICKS_TO_WAIT);
-#else
-    // SSD1306: Send data in one transaction
-    uint8_t oled_buffer[OLED_WIDTH + 1] = {0};
-    oled_buffer[0] = OLED_DAT_MODE;
-    
-    for(uint8_t i = 0; i < OLED_WIDTH; i++)
-    {
-        oled_buffer[i + 1] = oled_buf[page][i];
-    }
-    
-    i2c_master_transmit(i2c_dev_handle, oled_buffer, OLED_WIDTH + 1, I2C_TICKS_TO_WAIT);
-#endif
+    return oled_first_frame_us;
 }
 
 /**
- * @fn oled_flush
+ * @fn oled_cmd_begin
  * 
- * @brief Flush all oled
+ * @brief Start an empty command batch, every command added to it is sent in a
+ * single OLED_CMD_MODE transaction by oled_cmd_commit()
  * 
- * @param none
+ * @param batch batch to start
  */
-void oled_flush(void)
+void oled_cmd_begin(oled_cmd_batch_t *batch)
 {
-  for (uint8_t p = 0; p < OLED_NUM_PAGES; p++)
-  {
-    oled_flush_page(p);
-  }
+    batch->buf[0] = OLED_CMD_MODE;
+    batch->len = 1;
 }
 
 /**
- * @fn oled_clear_buffer
+ * @fn oled_cmd_append
  * 
- * @brief Clear the oled buffer
+ * @brief Append a command with its arguments, all or nothing
  * 
- * @param none
+ * @param batch batch to fill
+ * @param cmds command bytes
+ * @param count number of command bytes
+ * 
+ * @return true if added, false if the batch has no room left
  */
-void oled_clear_buffer(void)
+static bool oled_cmd_append(oled_cmd_batch_t *batch, const uint8_t *cmds, uint8_t count)
 {
-  memset(oled_buf, 0x00, sizeof(oled_buf));
+    if (batch->len + count > sizeof(batch->buf))
+        return false;
+
+    memcpy(&batch->buf[batch->len], cmds, count);
+    batch->len += count;
+    return true;
 }
 
 /**
- * @fn oled_clear
+ * @fn oled_cmd_add
  * 
- * @brief Clear the oled and display
+ * @brief Add a raw controller command byte to the batch
  * 
- * @param none
+ * @param batch batch to fill
+ * @param cmd command byte
+ * 
+ * @return true if added, false if the batch has no room left
  */
-void oled_clear(void)
+bool oled_cmd_add(oled_cmd_batch_t *batch, uint8_t cmd)
 {
-  oled_clear_buffer();
-  oled_flush();
+    return oled_cmd_append(batch, &cmd, 1);
 }
 
 /**
- * @fn oled_set_pixel
+ * @fn oled_cmd_commit
  * 
- * @brief Set a pixel on the oled
+ * @brief Send the batch in one transaction and leave it empty for reuse
  * 
- * @param x set position on x axe for the pixel
- * @param y set position on y axe for the pixel
- * @param color 0 or 1 to show on the display
+ * @param batch batch to send
  */
-void oled_set_pixel(int16_t x, int16_t y, uint8_t color)
+void oled_cmd_commit(oled_cmd_batch_t *batch)
 {
-  if (x < 0 || x >= OLED_WIDTH || y < 0 || y >= OLED_HEIGHT)
-    return;
-  uint8_t page = y >> 3;  // y / 8
-  uint8_t bit = y & 0x07; // y % 8
-  if (color)
-    oled_buf[page][x] |= (1 << bit);
-  else
-    oled_buf[page][x] &= ~(1 << bit);
+    if (batch->len > 1)
+    {
+        i2c_master_transmit(i2c_dev_handle, batch->buf, batch->len, I2C_TICKS_TO_WAIT);
+    }
+    oled_cmd_begin(batch);
 }
 
 /**
- * @fn oled_set_pixel
+ * @fn oled_cmd_position
  * 
- * @brief Set a pixel on the oled
+ * @brief Add the page and column position commands to the batch
  * 
- * @param x set position on x axe on the oled
- * @param y set position on y axe on the oled
- * @param w width of the bitmap
- * @param h height of the bitmap
- * @param bitmap the array of the bitmap
+ * @param batch batch to fill
+ * @param x set position on x
+ * @param y set page on y
+ * 
+ * @return true if added, false if the batch has no room left
  */
-void oled_draw_bmp(int16_t x, int16_t y, int16_t w, int16_t h, const uint8_t *bitmap)
+bool oled_cmd_position(oled_cmd_batch_t *batch, uint8_t x, uint8_t y)
 {
-  for (int16_t j = 0; j < h; j++)
-  {
-    for (int16_t i = 0; i < w; i++)
-    {
-      int byte_index = (j / 8) * w + i;
-      uint8_t bit_mask = 1 << (j & 7);
+    uint8_t column = x;
 
-      uint8_t pixel = (bitmap[byte_index] & bit_mask) ? 1 : 0;
+#ifdef CONFIG_CHIP_SH1106
+    // SH1106 needs offset of +2 columns (has 132 column buffer but only displays 128)
+    column += 2;
+#endif
 
-      oled_set_pixel(x + i, y + j, pixel);
-    }
-  }
+    const uint8_t cmds[] = {
+        OLED_PAGE | y,
+        OLED_COLUMN_LOW | (column & 0x0F),
+        OLED_COLUMN_HIGH | ((column >> 4) & 0x0F),
+    };
+    return oled_cmd_append(batch, cmds, sizeof(cmds));
 }
 
 /**
- * @fn transpose_letter
+ * @fn oled_cmd_contrast
+ * 
+ * @brief Add the contrast command to the batch
  * 
- * @brief transpose the letter to match with the oled
+ * @param batch batch to fill
+ * @param contrast 0 (dim) to 255 (bright)
  * 
- * @param in array to transpose
- * @param out array transposed
- * @param w width of the letter
- * @param h height of the letter
+ * @return true if added, false if the batch has no room left
  */
-static void transpose_letter(const char in[8], uint8_t out[8],uint8_t width, uint8_t height)
+bool oled_cmd_contrast(oled_cmd_batch_t *batch, uint8_t contrast)
 {
-  for (uint8_t x = 0; x < width; x++)
-  {
-    uint8_t col = 0;
-    for (uint8_t y = 0; y < height; y++)
-    {
-      if (in[y] & (1 << x))
-      {
-        col |= (1 << y);
-      }
-    }
-    out[x] = col;
-  }
+    const uint8_t cmds[] = { OLED_CONTRAST, contrast };
+    return oled_cmd_append(batch, cmds, sizeof(cmds));
 }
 
 /**
- * @fn oled_draw_char8x8
+ * @fn oled_cmd_invert
  * 
- * @brief draw a single char for font 8x8
+ * @brief Add the inverse display command to the batch
  * 
- * @param x set position of the letter on x
- * @param y set position of the letter on y
- * @param c character to display on buffer
+ * @param batch batch to fill
+ * @param invert true to show lit pixels as dark
+ * 
+ * @return true if added, false if the batch has no room left
  */
-void oled_draw_char8x8(uint8_t x, uint8_t y, char c)
+bool oled_cmd_invert(oled_cmd_batch_t *batch, bool invert)
 {
-  if (c < 32 || c > 127)
-    c = ' ';
-  uint8_t transposed[8];
-  transpose_letter(font8x8_basic[c - 32], transposed,8,8);
-  oled_draw_bmp(x, y,8, 8, transposed);
+    return oled_cmd_add(batch, invert ? OLED_INVERT : OLED_INVERT_OFF);
 }
 
 /**
- * @fn oled_print_8x8
+ * @fn oled_cmd_flip
  * 
- * @brief draw a text on the oled with font 8x8
+ * @brief Add the segment remap and COM scan direction commands to the batch,
+ * the horizontal flip only applies to data written after it
  * 
- * @param x set position of the text on x
- * @param y set position of the text on y
- * @param text  text to display on the oled
+ * @param batch batch to fill
+ * @param x_flip flip the display horizontally
+ * @param y_flip flip the display vertically
+ * 
+ * @return true if added, false if the batch has no room left
  */
-void oled_print_8x8(uint8_t x, uint8_t y, const char *text)
+bool oled_cmd_flip(oled_cmd_batch_t *batch, bool x_flip, bool y_flip)
 {
-  while (*text)
-  {
-    oled_draw_char8x8(x, y, *text++);
-    x += 8;
-  }
+    const uint8_t cmds[] = {
+        x_flip ? OLED_XFLIP : OLED_XFLIP_OFF,
+        y_flip ? OLED_YFLIP : OLED_YFLIP_OFF,
+    };
+    return oled_cmd_append(batch, cmds, sizeof(cmds));
 }
 
 /**
- * @fn oled_draw_char6x8
+ * @fn oled_cmd_display
  * 
- * @brief draw a single char for font 6x8
+ * @brief Add the display on/off command to the batch, the display RAM is kept while off
  * 
- * @param x set position of the letter on x
- * @param y set position of the letter on y
- * @param c character to display on buffer
+ * @param batch batch to fill
+ * @param on true to turn the panel on, false for sleep mode
+ * 
+ * @return true if added, false if the batch has no room left
  */
-void oled_draw_char6x8(uint8_t x, uint8_t y, char c)
+bool oled_cmd_display(oled_cmd_batch_t *batch, bool on)
 {
-  if (c < 32 || c > 127)
-    c = ' ';
-  oled_draw_bmp(x, y, 6, 8, (const uint8_t *)font_6x8[c - 32]);
+    return oled_cmd_add(batch, on ? OLED_DISPLAY_ON : OLED_DISPLAY_OFF);
 }
 
+#if defined(CONFIG_OLED_FRAMEBUFFER) && !defined(CONFIG_CHIP_SH1106)
 /**
- * @fn oled_print_6x8
+ * @fn oled_cmd_window
  * 
- * @brief draw a text on the oled with font 6x8
+ * @brief Add the SSD1306 column and page address window commands to the batch
  * 
- * @param x set position of the text on x
- * @param y set position of the text on y
- * @param text  text to display on the oled
+ * @param batch batch to fill
+ * @param first_col first column of the window
+ * @param last_col last column of the window
+ * @param first_page first page of the window
+ * @param last_page last page of the window
+ * 
+ * @return true if added, false if the batch has no room left
  */
-void oled_print_6x8(uint8_t x, uint8_t y, const char *text)
+static bool oled_cmd_window(oled_cmd_batch_t *batch, uint8_t first_col, uint8_t last_col,
+                            uint8_t first_page, uint8_t last_page)
 {
-  while (*text)
-  {
-    oled_draw_char6x8(x, y, *text++);
-    x += 7;
-  }
+    const uint8_t cmds[] = {
+        OLED_COLUMNS, first_col, last_col,
+        OLED_PAGES, first_page, last_page,
+    };
+    return oled_cmd_append(batch, cmds, sizeof(cmds));
 }
+#endif
 
 /**
- * @fn oled_draw_char5x8
+ * @fn oled_set_position
  * 
- * @brief draw a single char for font 5x8
+ * @brief This function sets the position on the oled
  * 
- * @param x set position of the letter on x
- * @param y set position of the letter on y
- * @param c character to display on buffer
+ * @param x set position on x
+ * 
+ * @param y set position on y
  */
-void oled_draw_char5x8(uint8_t x, uint8_t y, char c)
+void oled_set_position(uint8_t x, uint8_t y) 
 {
-  if (c < 32 || c > 127)
-    c = ' ';
-  oled_draw_bmp(x, y, 6, 8, (const uint8_t *)font_5x8[c - 32]);
+    oled_cmd_batch_t batch;
+    oled_cmd_begin(&batch);
+    oled_cmd_position(&batch, x, y);
+    oled_cmd_commit(&batch);
 }
 
 /**
- * @fn oled_print_5x8
+ * @fn oled_set_contrast
  * 
- * @brief draw a text on the oled with font 5x8
+ * @brief Set the contrast of the display in one transaction
  * 
- * @param x set position of the text on x
- * @param y set position of the text on y
- * @param text  text to display on the oled
+ * @param contrast 0 (dim) to 255 (bright)
  */
-void oled_print_5x8(uint8_t x, uint8_t y, const char *text)
+void oled_set_contrast(uint8_t contrast)
 {
-  while (*text)
-  {
-    oled_draw_char5x8(x, y, *text++);
-    x += 6;
-  }
+    oled_cmd_batch_t batch;
+    oled_cmd_begin(&batch);
+    oled_cmd_contrast(&batch, contrast);
+    oled_cmd_commit(&batch);
 }
 
 /**
- * @fn oled_draw_hline
+ * @fn oled_set_invert
+ * 
+ * @brief Invert the display in one transaction
+ * 
+ * @param invert true to show lit pixels as dark
+ */
+void oled_set_invert(bool invert)
+{
+    oled_cmd_batch_t batch;
+    oled_cmd_begin(&batch);
+    oled_cmd_invert(&batch, invert);
+    oled_cmd_commit(&batch);
+}
+
+/**
+ * @fn oled_set_flip
+ * 
+ * @brief Flip the display in one transaction, flush again to see the horizontal flip
+ * 
+ * @param x_flip flip the display horizontally
+ * @param y_flip flip the display vertically
+ */
+void oled_set_flip(bool x_flip, bool y_flip)
+{
+    oled_cmd_batch_t batch;
+    oled_cmd_begin(&batch);
+    oled_cmd_flip(&batch, x_flip, y_flip);
+    oled_cmd_commit(&batch);
+}
+
+/**
+ * @fn oled_set_display
+ * 
+ * @brief Turn the display on or off in one transaction
+ * 
+ * @param on true to turn the panel on, false for sleep mode
+ */
+void oled_set_display(bool on)
+{
+    oled_cmd_batch_t batch;
+    oled_cmd_begin(&batch);
+    oled_cmd_display(&batch, on);
+    oled_cmd_commit(&batch);
+}
+
+/**
+ * @fn oled_transpose8x8
+ * 
+ * @brief Transpose an 8x8 bit block, bit x of in[y] goes to bit y of out[x].
+ * Swaps the 4x4, 2x2 and 1x1 sub-blocks with masks instead of moving single bits
+ * 
+ * @param in block to transpose
+ * @param out block transposed, can be the same array as in
+ */
+static void oled_transpose8x8(const uint8_t in[8], uint8_t out[8])
+{
+  uint32_t lo = in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+  uint32_t hi = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+  uint32_t t;
+
+  // Swap the top right and bottom left 4x4 blocks
+  t = ((lo >> 4) ^ hi) & 0x0F0F0F0F;
+  hi ^= t;
+  lo ^= t << 4;
+
+  // Swap the 2x2 blocks inside every 4x4 block
+  t = (lo ^ (lo >> 14)) & 0x0000CCCC;
+  lo ^= t ^ (t << 14);
+  t = (hi ^ (hi >> 14)) & 0x0000CCCC;
+  hi ^= t ^ (t << 14);
+
+  // Swap the single bits inside every 2x2 block
+  t = (lo ^ (lo >> 7)) & 0x00AA00AA;
+  lo ^= t ^ (t << 7);
+  t = (hi ^ (hi >> 7)) & 0x00AA00AA;
+  hi ^= t ^ (t << 7);
+
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    out[i] = lo >> (8 * i);
+    out[i + 4] = hi >> (8 * i);
+  }
+}
+
+/**
+ * @fn oled_font_advance
+ * 
+ * @brief space taken by a letter on x, same advance as the print functions
+ * 
+ * @param font font of the letter
+ * 
+ * @return advance in pixels
+ */
+static uint8_t oled_font_advance(oled_font_t font)
+{
+  switch (font)
+  {
+    case OLED_FONT_5X8: return 6;
+    case OLED_FONT_6X8: return 7;
+    case OLED_FONT_8X8: return 8;
+  }
+  return 0;
+}
+
+/**
+ * @fn oled_glyph_columns
+ * 
+ * @brief Get the column bytes of a letter, same columns the draw_char functions use
+ * 
+ * @param font font of the letter
+ * @param c character to get
+ * @param out column bytes of the letter
+ * 
+ * @return number of columns of the letter
+ */
+static uint8_t oled_glyph_columns(oled_font_t font, char c, uint8_t out[8])
+{
+  if (c < 32 || c > 126)
+    c = ' ';
+
+  switch (font)
+  {
+    case OLED_FONT_5X8:
+      memcpy(out, font_5x8[c - 32], 5);
+      out[5] = 0x00;
+      return 6;
+    case OLED_FONT_6X8:
+      memcpy(out, font_6x8[c - 32], 6);
+      return 6;
+    case OLED_FONT_8X8:
+      oled_transpose8x8((const uint8_t *)font8x8_basic[c - 32], out);
+      return 8;
+  }
+  return 0;
+}
+
+#ifdef CONFIG_OLED_FRAMEBUFFER
+
+/**
+ * @fn oled_set_rotation
+ * 
+ * @brief Set the rotation of the drawing functions. 180 degrees is done by the
+ * controller remap commands at no cost, 90 and 270 degrees are done while drawing
+ * and swap the width and height of the screen. The buffer is not redrawn, so
+ * clear it and draw again after changing the rotation. The viewport is reset
+ * 
+ * @param rotation rotation of the screen
+ */
+void oled_set_rotation(oled_rotation_t rotation)
+{
+    oled_cmd_batch_t batch;
+    oled_cmd_begin(&batch);
+
+    // The init sequence flips both axes, 180 degrees is undoing that flip
+    if (rotation == OLED_ROTATION_180)
+        oled_cmd_flip(&batch, false, false);
+    else
+        oled_cmd_flip(&batch, true, true);
+
+    oled_cmd_commit(&batch);
+
+    oled_rotation = rotation;
+    if (rotation == OLED_ROTATION_90 || rotation == OLED_ROTATION_270)
+    {
+        oled_width = OLED_HEIGHT;
+        oled_height = OLED_WIDTH;
+    }
+    else
+    {
+        oled_width = OLED_WIDTH;
+        oled_height = OLED_HEIGHT;
+    }
+
+    oled_reset_viewport();
+}
+
+/**
+ * @fn oled_get_width
+ * 
+ * @brief Get the width of the screen for the current rotation
+ * 
+ * @return width in pixels
+ */
+int16_t oled_get_width(void)
+{
+    return oled_width;
+}
+
+/**
+ * @fn oled_get_height
+ * 
+ * @brief Get the height of the screen for the current rotation
+ * 
+ * @return height in pixels
+ */
+int16_t oled_get_height(void)
+{
+    return oled_height;
+}
+
+/**
+ * @fn oled_set_viewport
+ * 
+ * @brief Move the origin of every drawing function to a rectangle of the screen
+ * and clip to it, so a widget can be drawn at any place with its own coordinates
+ * 
+ * @param x left of the viewport on the screen
+ * @param y top of the viewport on the screen
+ * @param width width of the viewport
+ * @param height height of the viewport
+ */
+void oled_set_viewport(int16_t x, int16_t y, int16_t width, int16_t height)
+{
+    int32_t right = (int32_t)x + width;
+    int32_t bottom = (int32_t)y + height;
+
+    oled_origin_x = x;
+    oled_origin_y = y;
+    oled_view_left = (x > 0) ? x : 0;
+    oled_view_top = (y > 0) ? y : 0;
+    oled_view_right = (right < oled_width) ? right : oled_width;
+    oled_view_bottom = (bottom < oled_height) ? bottom : oled_height;
+
+    oled_reset_clip();
+}
+
+/**
+ * @fn oled_reset_viewport
+ * 
+ * @brief Draw on the whole screen again, without origin or clip
+ * 
+ * @param none
+ */
+void oled_reset_viewport(void)
+{
+    oled_set_viewport(0, 0, oled_width, oled_height);
+}
+
+/**
+ * @fn oled_set_clip
+ * 
+ * @brief Limit the drawing functions to a rectangle of the viewport, nothing
+ * outside of it is changed
+ * 
+ * @param x left of the clip rectangle in the viewport
+ * @param y top of the clip rectangle in the viewport
+ * @param width width of the clip rectangle
+ * @param height height of the clip rectangle
+ */
+void oled_set_clip(int16_t x, int16_t y, int16_t width, int16_t height)
+{
+    int32_t left = (int32_t)x + oled_origin_x;
+    int32_t top = (int32_t)y + oled_origin_y;
+    int32_t right = left + width;
+    int32_t bottom = top + height;
+
+    oled_clip_left = (left > oled_view_left) ? left : oled_view_left;
+    oled_clip_top = (top > oled_view_top) ? top : oled_view_top;
+    oled_clip_right = (right < oled_view_right) ? right : oled_view_right;
+    oled_clip_bottom = (bottom < oled_view_bottom) ? bottom : oled_view_bottom;
+}
+
+/**
+ * @fn oled_reset_clip
+ * 
+ * @brief Clip to the whole viewport again
+ * 
+ * @param none
+ */
+void oled_reset_clip(void)
+{
+    oled_clip_left = oled_view_left;
+    oled_clip_top = oled_view_top;
+    oled_clip_right = oled_view_right;
+    oled_clip_bottom = oled_view_bottom;
+}
+
+/**
+ * @fn oled_clip_rect
+ * 
+ * @brief Move a rectangle of the viewport to the screen and cut it to the clip
+ * rectangle, every primitive does this once before touching the buffer
+ * 
+ * @param x left of the rectangle, replaced by the visible left on the screen
+ * @param y top of the rectangle, replaced by the visible top on the screen
+ * @param width width of the rectangle, replaced by the visible width
+ * @param height height of the rectangle, replaced by the visible height
+ * 
+ * @return false if nothing of the rectangle is visible
+ */
+static bool oled_clip_rect(int16_t *x, int16_t *y, int16_t *width, int16_t *height)
+{
+    int32_t left = (int32_t)*x + oled_origin_x;
+    int32_t top = (int32_t)*y + oled_origin_y;
+    int32_t right = left + *width;
+    int32_t bottom = top + *height;
+
+    if (left < oled_clip_left) left = oled_clip_left;
+    if (top < oled_clip_top) top = oled_clip_top;
+    if (right > oled_clip_right) right = oled_clip_right;
+    if (bottom > oled_clip_bottom) bottom = oled_clip_bottom;
+
+    if (left >= right || top >= bottom)
+        return false;
+
+    *x = left;
+    *y = top;
+    *width = right - left;
+    *height = bottom - top;
+    return true;
+}
+
+/**
+ * @fn oled_flush_page
+ * 
+ * @brief Flush any page from the oled
+ * 
+ * @param page number of page to flush
+ */
+static void oled_flush_page(uint8_t page)
+{
+    if(page >= OLED_NUM_PAGES) return;
+
+#ifdef CONFIG_CHIP_SH1106
+    // SH1106 needs separate command and data transactions (as per example)
+    // First transaction: Set page and column address (offset by +2 columns)
+    uint8_t cmd_buffer[5] = {0};
+    cmd_buffer[0] = OLED_CMD_MODE;
+    cmd_buffer[1] = OLED_PAGE | page;                          // Set page address
+    cmd_buffer[2] = OLED_COLUMN_LOW | 0x02;                    // Set lower column (offset +2)
+    cmd_buffer[3] = OLED_COLUMN_HIGH | 0x00;                   // Set higher column
+    i2c_master_transmit(i2c_dev_handle, cmd_buffer, 4, I2C_TICKS_TO_WAIT);
+    
+    // Second transaction: Send data
+    uint8_t data_buffer[OLED_WIDTH + 1] = {0};
+    data_buffer[0] = OLED_DAT_MODE;
+    for(uint8_t i = 0; i < OLED_WIDTH; i++)
+    {
+        data_buffer[i + 1] = oled_buf[page][i];
+    }
+    i2c_master_transmit(i2c_dev_handle, data_buffer, OLED_WIDTH + 1, I2C_TICKS_TO_WAIT);
+#else
+    // SSD1306: Send data in one transaction
+    uint8_t oled_buffer[OLED_WIDTH + 1] = {0};
+    oled_buffer[0] = OLED_DAT_MODE;
+    
+    for(uint8_t i = 0; i < OLED_WIDTH; i++)
+    {
+        oled_buffer[i + 1] = oled_buf[page][i];
+    }
+    
+    i2c_master_transmit(i2c_dev_handle, oled_buffer, OLED_WIDTH + 1, I2C_TICKS_TO_WAIT);
+#endif
+}
+
+/**
+ * @fn oled_flush_columns
+ * 
+ * @brief Flush a range of columns of a page, position and data in one transaction
+ * 
+ * @param page number of page to flush
+ * @param first first column to flush
+ * @param last last column to flush
+ */
+static void oled_flush_columns(uint8_t page, uint8_t first, uint8_t last)
+{
+    uint8_t count = last - first + 1;
+    uint8_t buffer[OLED_DIRECT_HEADER_MAX + OLED_WIDTH];
+    uint8_t len = oled_direct_header(buffer, first, page, count);
+
+    memcpy(&buffer[len], &oled_buf[page][first], count);
+    i2c_master_transmit(i2c_dev_handle, buffer, len + count, I2C_TICKS_TO_WAIT);
+}
+
+/**
+ * @fn oled_mark_dirty_columns
+ * 
+ * @brief Mark a rectangle of the buffer to be sent by oled_flush_dirty()
+ * 
+ * @param x starting column on the buffer
+ * @param y starting row on the buffer
+ * @param width rectangle width
+ * @param height rectangle height
+ */
+static void oled_mark_dirty_columns(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
+{
+    uint8_t last_col = x + width - 1;
+
+    for (uint8_t page = y >> 3; page <= ((y + height - 1) >> 3); page++)
+    {
+        if (x < oled_dirty_first[page]) oled_dirty_first[page] = x;
+        if (last_col > oled_dirty_last[page]) oled_dirty_last[page] = last_col;
+    }
+}
+
+/**
+ * @fn oled_flush
+ * 
+ * @brief Flush all oled. While the flush scheduler runs, a call from another
+ * task is handed to the scheduler task as an urgent flush
+ * 
+ * @param none
+ */
+void oled_flush(void)
+{
+  if (oled_sched_task != NULL && xTaskGetCurrentTaskHandle() != oled_sched_task)
+  {
+    oled_request_flush_now();
+    return;
+  }
+
+#ifndef CONFIG_CHIP_SH1106
+  if (!oled_window_full)
+  {
+    // A partial flush moved the address window, give the whole screen back
+    oled_cmd_batch_t batch;
+    oled_cmd_begin(&batch);
+    oled_cmd_window(&batch, 0, OLED_WIDTH - 1, 0, OLED_NUM_PAGES - 1);
+    oled_cmd_commit(&batch);
+    oled_window_full = true;
+  }
+#endif
+
+  for (uint8_t p = 0; p < OLED_NUM_PAGES; p++)
+  {
+    oled_flush_page(p);
+    oled_dirty_first[p] = 0xFF;
+    oled_dirty_last[p] = 0;
+  }
+}
+
+/**
+ * @fn oled_flush_dirty
+ * 
+ * @brief Flush only the columns marked as changed, one transfer per changed page.
+ * While the flush scheduler runs, a call from another task is handed to the
+ * scheduler task as a dirty flush request
+ * 
+ * @param none
+ */
+void oled_flush_dirty(void)
+{
+  if (oled_sched_task != NULL && xTaskGetCurrentTaskHandle() != oled_sched_task)
+  {
+    oled_request_flush_dirty();
+    return;
+  }
+
+  for (uint8_t p = 0; p < OLED_NUM_PAGES; p++)
+  {
+    if (oled_dirty_first[p] > oled_dirty_last[p])
+      continue;
+
+    oled_flush_columns(p, oled_dirty_first[p], oled_dirty_last[p]);
+    oled_dirty_first[p] = 0xFF;
+    oled_dirty_last[p] = 0;
+  }
+}
+
+/**
+ * @fn oled_clear_buffer
+ * 
+ * @brief Clear the oled buffer
+ * 
+ * @param none
+ */
+void oled_clear_buffer(void)
+{
+  memset(oled_buf, 0x00, sizeof(oled_buf));
+}
+
+/**
+ * @fn oled_clear
+ * 
+ * @brief Clear the oled and display. While the flush scheduler runs, a call from
+ * another task queues the clear and an urgent flush for the scheduler task
+ * 
+ * @param none
+ */
+void oled_clear(void)
+{
+  if (oled_sched_task != NULL && xTaskGetCurrentTaskHandle() != oled_sched_task)
+  {
+    // The clear must not be lost, wait for a free slot
+    while (!oled_queue_clear())
+    {
+      vTaskDelay(1);
+    }
+    oled_request_flush_now();
+    return;
+  }
+
+  oled_clear_buffer();
+  oled_flush();
+}
+
+/**
+ * @fn oled_queue_init
+ * 
+ * @brief Mark every slot of the draw queue as free
+ * 
+ * @param none
+ */
+static void oled_queue_init(void)
+{
+  for (unsigned int i = 0; i < OLED_QUEUE_LENGTH; i++)
+  {
+    atomic_init(&oled_queue[i].seq, i);
+  }
+}
+
+/**
+ * @fn oled_queue_push
+ * 
+ * @brief Copy a draw command into the queue without locking, safe from any task on any core
+ * 
+ * @param cmd command to queue
+ * 
+ * @return true if queued, false if the queue is full or not started
+ */
+static bool oled_queue_push(const oled_draw_cmd_t *cmd)
+{
+  if (!atomic_load_explicit(&oled_queue_ready, memory_order_acquire))
+    return false;
+
+  oled_queue_slot_t *slot;
+  unsigned int pos = atomic_load_explicit(&oled_queue_tail, memory_order_relaxed);
+
+  for (;;)
+  {
+    slot = &oled_queue[pos & OLED_QUEUE_MASK];
+    unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    int diff = (int)(seq - pos);
+
+    if (diff == 0)
+    {
+      // Slot is free, claim it by moving the tail
+      if (atomic_compare_exchange_weak_explicit(&oled_queue_tail, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      // The render task has not consumed this slot yet
+      return false;
+    }
+    else
+    {
+      // Another producer took the slot
+      pos = atomic_load_explicit(&oled_queue_tail, memory_order_relaxed);
+    }
+  }
+
+  slot->cmd = *cmd;
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+  xTaskNotify(oled_sched_task, OLED_SCHED_DRAW, eSetBits);
+  return true;
+}
+
+/**
+ * @fn oled_print_font
+ * 
+ * @brief draw a text on the oled with the given font
+ * 
+ * @param font font of the text
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text text to display on the oled
+ */
+static void oled_print_font(oled_font_t font, int16_t x, int16_t y, const char *text)
+{
+  switch (font)
+  {
+    case OLED_FONT_5X8: oled_print_5x8(x, y, text); break;
+    case OLED_FONT_6X8: oled_print_6x8(x, y, text); break;
+    case OLED_FONT_8X8: oled_print_8x8(x, y, text); break;
+  }
+}
+
+/**
+ * @fn oled_queue_drain
+ * 
+ * @brief Render every queued draw command into the buffer, only called by the scheduler task
+ * 
+ * @param none
+ */
+static void oled_queue_drain(void)
+{
+  for (;;)
+  {
+    oled_queue_slot_t *slot = &oled_queue[oled_queue_head & OLED_QUEUE_MASK];
+    unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != oled_queue_head + 1)
+      return;
+
+    oled_draw_cmd_t *cmd = &slot->cmd;
+    oled_set_viewport(cmd->view.x, cmd->view.y, cmd->view.width, cmd->view.height);
+    if (cmd->view.clip_width != 0 || cmd->view.clip_height != 0)
+      oled_set_clip(cmd->view.clip_x, cmd->view.clip_y, cmd->view.clip_width, cmd->view.clip_height);
+
+    switch (cmd->type)
+    {
+      case OLED_DRAW_PRINT:
+        oled_print_font(cmd->print.font, cmd->x, cmd->y, cmd->print.text);
+        break;
+      case OLED_DRAW_BMP:
+        oled_draw_bmp(cmd->x, cmd->y, cmd->bmp.w, cmd->bmp.h, cmd->bmp.bitmap);
+        break;
+      case OLED_DRAW_FILL:
+        oled_fill_rect(cmd->x, cmd->y, cmd->fill.w, cmd->fill.h, cmd->fill.color);
+        break;
+      case OLED_DRAW_CLEAR:
+        oled_clear_buffer();
+        break;
+      case OLED_DRAW_COMMANDS:
+        oled_cmd_commit(&cmd->commands);
+        break;
+      case OLED_DRAW_ROTATION:
+        oled_set_rotation(cmd->rotation);
+        break;
+    }
+    oled_reset_viewport();
+
+    // Hand the slot back to the producers
+    atomic_store_explicit(&slot->seq, oled_queue_head + OLED_QUEUE_LENGTH, memory_order_release);
+    oled_queue_head++;
+  }
+}
+
+/**
+ * @fn oled_sched_loop
+ * 
+ * @brief Scheduler task, it owns the buffer and the bus: renders the queued draw
+ * commands and merges every flush request received inside a frame period into
+ * a single oled_flush()
+ * 
+ * @param arg not used
+ */
+static void oled_sched_loop(void *arg)
+{
+  TickType_t last_flush = xTaskGetTickCount() - oled_frame_period;
+  uint32_t events;
+
+  for (;;)
+  {
+    xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+    oled_queue_drain();
+
+    if (!(events & (OLED_SCHED_REQUEST | OLED_SCHED_URGENT | OLED_SCHED_DIRTY)))
+      continue;
+
+    // Hold the flush until the frame slot opens, unless something urgent arrives
+    while (!(events & OLED_SCHED_URGENT))
+    {
+      TickType_t elapsed = xTaskGetTickCount() - last_flush;
+      if (elapsed >= oled_frame_period)
+        break;
+
+      uint32_t more = 0;
+      xTaskNotifyWait(0, UINT32_MAX, &more, oled_frame_period - elapsed);
+      events |= more;
+      oled_queue_drain();
+    }
+
+    // Send only the changed columns unless a full flush was asked for
+    if (events & (OLED_SCHED_REQUEST | OLED_SCHED_URGENT))
+      oled_flush();
+    else
+      oled_flush_dirty();
+    last_flush = xTaskGetTickCount();
+  }
+}
+
+/**
+ * @fn oled_start_flush_scheduler
+ * 
+ * @brief Start the flush scheduler. Its task becomes the owner of the buffer and
+ * the bus, and flushes at most once per frame period. oled_flush(), oled_flush_dirty()
+ * and oled_clear() called from other tasks are handed to it. Other tasks must draw with the
+ * oled_queue_* functions and send commands with oled_queue_commands(): the
+ * drawing functions, oled_clear_buffer(), the viewport, clip and rotation
+ * functions, the oled_set_* functions and the
+ * oled_direct_* functions write to the buffer or the bus right away and must not
+ * be called from them while the scheduler runs. Calling it again only changes the period
+ * 
+ * @param frame_period_ms minimum time between two flushes in milliseconds
+ */
+void oled_start_flush_scheduler(uint32_t frame_period_ms)
+{
+  oled_frame_period = pdMS_TO_TICKS(frame_period_ms);
+
+  if (oled_sched_task != NULL)
+    return;
+
+  oled_queue_init();
+
+  if (xTaskCreate(oled_sched_loop, "oled_sched", OLED_SCHED_STACK_SIZE, NULL,
+                  OLED_SCHED_PRIORITY, &oled_sched_task) != pdPASS)
+  {
+    ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+  }
+
+  // Producers may push only once there is a task to wake up
+  atomic_store_explicit(&oled_queue_ready, true, memory_order_release);
+}
+
+/**
+ * @fn oled_request_flush
+ * 
+ * @brief Ask for the buffer to be sent on the next frame slot, requests made
+ * before that slot are merged. Without the scheduler it flushes right away
+ * 
+ * @param none
+ */
+void oled_request_flush(void)
+{
+  if (oled_sched_task == NULL)
+  {
+    oled_flush();
+    return;
+  }
+  xTaskNotify(oled_sched_task, OLED_SCHED_REQUEST, eSetBits);
+}
+
+/**
+ * @fn oled_request_flush_now
+ * 
+ * @brief Ask for the buffer to be sent without waiting for the frame slot,
+ * for urgent content. Without the scheduler it flushes right away
+ * 
+ * @param none
+ */
+void oled_request_flush_now(void)
+{
+  if (oled_sched_task == NULL)
+  {
+    oled_flush();
+    return;
+  }
+  xTaskNotify(oled_sched_task, OLED_SCHED_URGENT, eSetBits);
+}
+
+/**
+ * @fn oled_request_flush_dirty
+ * 
+ * @brief Ask for the changed columns to be sent on the next frame slot, merged
+ * with the other requests made before that slot. A full flush request in the
+ * same slot wins. Without the scheduler it flushes the changed columns right away
+ * 
+ * @param none
+ */
+void oled_request_flush_dirty(void)
+{
+  if (oled_sched_task == NULL)
+  {
+    oled_flush_dirty();
+    return;
+  }
+  xTaskNotify(oled_sched_task, OLED_SCHED_DIRTY, eSetBits);
+}
+
+/**
+ * @fn oled_queue_view
+ * 
+ * @brief Store the view a command is drawn in, NULL is the whole screen in the
+ * rotation the command is drawn with
+ * 
+ * @param cmd command to fill
+ * @param view viewport and clip of the command, or NULL
+ */
+static void oled_queue_view(oled_draw_cmd_t *cmd, const oled_view_t *view)
+{
+  if (view != NULL)
+  {
+    cmd->view = *view;
+    return;
+  }
+  cmd->view = (oled_view_t){ .width = INT16_MAX, .height = INT16_MAX };
+}
+
+/**
+ * @fn oled_queue_print
+ * 
+ * @brief Queue a text to be drawn by the scheduler task, the text is copied
+ * (up to 21 characters) so the caller can reuse it right away
+ * 
+ * @param view viewport and clip to draw in, NULL for the whole screen
+ * @param font font of the text
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text text to display on the oled
+ * 
+ * @return true if queued, false if the queue is full or the scheduler is not running
+ */
+bool oled_queue_print(const oled_view_t *view, oled_font_t font, int16_t x, int16_t y, const char *text)
+{
+  oled_draw_cmd_t cmd = {
+    .type = OLED_DRAW_PRINT,
+    .x = x,
+    .y = y,
+    .print.font = font,
+  };
+  oled_queue_view(&cmd, view);
+  strncpy(cmd.print.text, text, OLED_QUEUE_TEXT_LEN);
+  return oled_queue_push(&cmd);
+}
+
+/**
+ * @fn oled_queue_bmp
+ * 
+ * @brief Queue a bitmap to be drawn by the scheduler task, the bitmap is not
+ * copied and must stay valid until it is rendered
+ * 
+ * @param view viewport and clip to draw in, NULL for the whole screen
+ * @param x set position on x axe on the oled
+ * @param y set position on y axe on the oled
+ * @param w width of the bitmap
+ * @param h height of the bitmap
+ * @param bitmap the array of the bitmap
+ * 
+ * @return true if queued, false if the queue is full or the scheduler is not running
+ */
+bool oled_queue_bmp(const oled_view_t *view, int16_t x, int16_t y, int16_t w, int16_t h, const uint8_t *bitmap)
+{
+  oled_draw_cmd_t cmd = {
+    .type = OLED_DRAW_BMP,
+    .x = x,
+    .y = y,
+    .bmp = { .w = w, .h = h, .bitmap = bitmap },
+  };
+  oled_queue_view(&cmd, view);
+  return oled_queue_push(&cmd);
+}
+
+/**
+ * @fn oled_queue_fill_rect
+ * 
+ * @brief Queue a filled rectangle to be drawn by the scheduler task
+ * 
+ * @param view viewport and clip to draw in, NULL for the whole screen
+ * @param x starting x position
+ * @param y starting y position
+ * @param width rectangle width
+ * @param height rectangle height
+ * @param color 0 = off, 1 = on
+ * 
+ * @return true if queued, false if the queue is full or the scheduler is not running
+ */
+bool oled_queue_fill_rect(const oled_view_t *view, int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color)
+{
+  oled_draw_cmd_t cmd = {
+    .type = OLED_DRAW_FILL,
+    .x = x,
+    .y = y,
+    .fill = { .w = width, .h = height, .color = color },
+  };
+  oled_queue_view(&cmd, view);
+  return oled_queue_push(&cmd);
+}
+
+/**
+ * @fn oled_queue_clear
+ * 
+ * @brief Queue a clear of the buffer, done by the scheduler task
+ * 
+ * @return true if queued, false if the queue is full or the scheduler is not running
+ */
+bool oled_queue_clear(void)
+{
+  oled_draw_cmd_t cmd = { .type = OLED_DRAW_CLEAR };
+  oled_queue_view(&cmd, NULL);
+  return oled_queue_push(&cmd);
+}
+
+/**
+ * @fn oled_queue_rotation
+ * 
+ * @brief Queue a rotation change, applied by the scheduler task between the
+ * commands queued before and after it
+ * 
+ * @param rotation new rotation of the drawing functions
+ * 
+ * @return true if queued, false if the queue is full or the scheduler is not running
+ */
+bool oled_queue_rotation(oled_rotation_t rotation)
+{
+  oled_draw_cmd_t cmd = {
+    .type = OLED_DRAW_ROTATION,
+    .rotation = rotation,
+  };
+  oled_queue_view(&cmd, NULL);
+  return oled_queue_push(&cmd);
+}
+
+/**
+ * @fn oled_queue_commands
+ * 
+ * @brief Queue a command batch to be sent by the scheduler task, so it never
+ * shares the bus with a flush. The batch is copied and can be reused right away
+ * 
+ * @param batch batch to send
+ * 
+ * @return true if queued, false if the queue is full or the scheduler is not running
+ */
+bool oled_queue_commands(const oled_cmd_batch_t *batch)
+{
+  oled_draw_cmd_t cmd = {
+    .type = OLED_DRAW_COMMANDS,
+    .commands = *batch,
+  };
+  oled_queue_view(&cmd, NULL);
+  return oled_queue_push(&cmd);
+}
+
+/**
+ * @fn oled_set_pixel
+ * 
+ * @brief Set a pixel on the oled
+ * 
+ * @param x set position on x axe for the pixel
+ * @param y set position on y axe for the pixel
+ * @param color 0 or 1 to show on the display
+ */
+void oled_set_pixel(int16_t x, int16_t y, uint8_t color)
+{
+  x += oled_origin_x;
+  y += oled_origin_y;
+  if (x < oled_clip_left || x >= oled_clip_right || y < oled_clip_top || y >= oled_clip_bottom)
+    return;
+
+  int16_t px = x;
+  int16_t py = y;
+
+  if (oled_rotation == OLED_ROTATION_90)
+  {
+    px = OLED_WIDTH - 1 - y;
+    py = x;
+  }
+  else if (oled_rotation == OLED_ROTATION_270)
+  {
+    px = y;
+    py = OLED_HEIGHT - 1 - x;
+  }
+
+  uint8_t page = py >> 3;  // y / 8
+  uint8_t bit = py & 0x07; // y % 8
+  if (color)
+    oled_buf[page][px] |= (1 << bit);
+  else
+    oled_buf[page][px] &= ~(1 << bit);
+}
+
+/**
+ * @fn oled_reverse_bits
+ * 
+ * @brief Mirror the bits of a column byte
+ * 
+ * @param b byte to mirror
+ * 
+ * @return byte mirrored
+ */
+static uint8_t oled_reverse_bits(uint8_t b)
+{
+  b = (b >> 4) | (b << 4);
+  b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2);
+  b = ((b & 0xAA) >> 1) | ((b & 0x55) << 1);
+  return b;
+}
+
+/**
+ * @fn oled_blit_columns
+ * 
+ * @brief Write column bytes into the buffer at any y, not only page aligned ones.
+ * Only the bits set in the mask are written
+ * 
+ * @param x position of the first column on the buffer
+ * @param y position of the top bit on the buffer
+ * @param src column bytes
+ * @param mask bits of every column to write
+ * @param count number of columns
+ */
+static void oled_blit_columns(int16_t x, int16_t y, const uint8_t *src, const uint8_t *mask, uint8_t count)
+{
+  int16_t page = y >> 3;
+  uint8_t shift = y & 0x07;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    int16_t col = x + i;
+    if (mask[i] == 0 || col < 0 || col >= OLED_WIDTH)
+      continue;
+
+    uint16_t bits = (uint16_t)(src[i] & mask[i]) << shift;
+    uint16_t keep = ~((uint16_t)mask[i] << shift);
+
+    if (page >= 0 && page < OLED_NUM_PAGES)
+      oled_buf[page][col] = (oled_buf[page][col] & keep) | bits;
+
+    if (shift && page + 1 >= 0 && page + 1 < OLED_NUM_PAGES)
+      oled_buf[page + 1][col] = (oled_buf[page + 1][col] & (keep >> 8)) | (bits >> 8);
+  }
+}
+
+/**
+ * @fn oled_draw_tile
+ * 
+ * @brief Draw a block of 8 columns by 8 rows, rotating the whole block with
+ * two transposes when the screen is in portrait
+ * 
+ * @param x position on x axe of the rotated screen
+ * @param y position on y axe of the rotated screen
+ * @param src column bytes of the block
+ * @param mask bits of every column to draw
+ */
+static void oled_draw_tile(int16_t x, int16_t y, const uint8_t src[8], const uint8_t mask[8])
+{
+  uint8_t rsrc[8];
+  uint8_t rmask[8];
+
+  if (oled_rotation == OLED_ROTATION_90)
+  {
+    // Rows become columns, the last row is the leftmost column
+    uint8_t tsrc[8];
+    uint8_t tmask[8];
+    oled_transpose8x8(src, tsrc);
+    oled_transpose8x8(mask, tmask);
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      rsrc[i] = tsrc[7 - i];
+      rmask[i] = tmask[7 - i];
+    }
+    oled_blit_columns(OLED_WIDTH - 8 - y, x, rsrc, rmask, 8);
+  }
+  else if (oled_rotation == OLED_ROTATION_270)
+  {
+    // Rows become columns, the first column is the bottom row
+    oled_transpose8x8(src, rsrc);
+    oled_transpose8x8(mask, rmask);
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      rsrc[i] = oled_reverse_bits(rsrc[i]);
+      rmask[i] = oled_reverse_bits(rmask[i]);
+    }
+    oled_blit_columns(y, OLED_HEIGHT - 8 - x, rsrc, rmask, 8);
+  }
+  else
+  {
+    oled_blit_columns(x, y, src, mask, 8);
+  }
+}
+
+/**
+ * @fn oled_draw_bmp
+ * 
+ * @brief Draw a bitmap on the oled, in blocks of 8x8 pixels. Only the blocks
+ * inside the clip rectangle are visited
+ * 
+ * @param x set position on x axe on the oled
+ * @param y set position on y axe on the oled
+ * @param w width of the bitmap
+ * @param h height of the bitmap
+ * @param bitmap the array of the bitmap
+ */
+void oled_draw_bmp(int16_t x, int16_t y, int16_t w, int16_t h, const uint8_t *bitmap)
+{
+  int16_t vx = x, vy = y, vw = w, vh = h;
+  if (!oled_clip_rect(&vx, &vy, &vw, &vh))
+    return;
+
+  // Visible part of the bitmap, relative to its top left corner
+  int16_t sx = x + oled_origin_x;
+  int16_t sy = y + oled_origin_y;
+  int16_t first_col = vx - sx;
+  int16_t end_col = first_col + vw;
+  int16_t first_row = vy - sy;
+  int16_t end_row = first_row + vh;
+
+  for (int16_t j = first_row & ~7; j < end_row; j += 8)
+  {
+    uint8_t top = (first_row > j) ? first_row - j : 0;
+    uint8_t bottom = (end_row - j < 8) ? end_row - j : 8;
+    uint8_t rows = (uint8_t)(0xFF << top) & (uint8_t)(0xFF >> (8 - bottom));
+    const uint8_t *line = &bitmap[(j / 8) * w];
+
+    for (int16_t i = first_col & ~7; i < end_col; i += 8)
+    {
+      uint8_t src[8] = {0};
+      uint8_t mask[8] = {0};
+
+      for (uint8_t c = 0; c < 8; c++)
+      {
+        if (i + c < first_col || i + c >= end_col)
+          continue;
+        src[c] = line[i + c];
+        mask[c] = rows;
+      }
+
+      oled_draw_tile(sx + i, sy + j, src, mask);
+    }
+  }
+}
+
+/**
+ * @fn oled_text_visible
+ * 
+ * @brief Check once if any part of a text is inside the clip rectangle, so
+ * invisible text skips the work of every letter
+ * 
+ * @param x position of the text on x
+ * @param y position of the text on y
+ * @param text text to check
+ * @param advance space taken by every letter on x
+ * @param height height of the letters
+ * 
+ * @return false if nothing of the text is visible
+ */
+static bool oled_text_visible(int16_t x, int16_t y, const char *text, int16_t advance, int16_t height)
+{
+  int32_t length = (int32_t)strlen(text) * advance;
+  int16_t width = (length > INT16_MAX) ? INT16_MAX : length;
+
+  return oled_clip_rect(&x, &y, &width, &height);
+}
+
+/**
+ * @fn oled_draw_char_font
+ * 
+ * @brief draw a single char with the given font, the glyph comes from
+ * oled_glyph_columns() like in every other text path
+ * 
+ * @param font font of the letter
+ * @param x set position of the letter on x
+ * @param y set position of the letter on y
+ * @param c character to display on buffer
+ */
+static void oled_draw_char_font(oled_font_t font, int16_t x, int16_t y, char c)
+{
+  uint8_t columns[8];
+  uint8_t width = oled_glyph_columns(font, c, columns);
+  oled_draw_bmp(x, y, width, 8, columns);
+}
+
+/**
+ * @fn oled_draw_char8x8
+ * 
+ * @brief draw a single char for font 8x8
+ * 
+ * @param x set position of the letter on x
+ * @param y set position of the letter on y
+ * @param c character to display on buffer
+ */
+void oled_draw_char8x8(int16_t x, int16_t y, char c)
+{
+  oled_draw_char_font(OLED_FONT_8X8, x, y, c);
+}
+
+/**
+ * @fn oled_print_8x8
+ * 
+ * @brief draw a text on the oled with font 8x8
+ * 
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text  text to display on the oled
+ */
+void oled_print_8x8(int16_t x, int16_t y, const char *text)
+{
+  if (!oled_text_visible(x, y, text, 8, 8))
+    return;
+
+  while (*text)
+  {
+    oled_draw_char8x8(x, y, *text++);
+    x += 8;
+  }
+}
+
+/**
+ * @fn oled_draw_char6x8
+ * 
+ * @brief draw a single char for font 6x8
+ * 
+ * @param x set position of the letter on x
+ * @param y set position of the letter on y
+ * @param c character to display on buffer
+ */
+void oled_draw_char6x8(int16_t x, int16_t y, char c)
+{
+  oled_draw_char_font(OLED_FONT_6X8, x, y, c);
+}
+
+/**
+ * @fn oled_print_6x8
+ * 
+ * @brief draw a text on the oled with font 6x8
+ * 
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text  text to display on the oled
+ */
+void oled_print_6x8(int16_t x, int16_t y, const char *text)
+{
+  if (!oled_text_visible(x, y, text, 7, 8))
+    return;
+
+  while (*text)
+  {
+    oled_draw_char6x8(x, y, *text++);
+    x += 7;
+  }
+}
+
+/**
+ * @fn oled_draw_char5x8
+ * 
+ * @brief draw a single char for font 5x8
+ * 
+ * @param x set position of the letter on x
+ * @param y set position of the letter on y
+ * @param c character to display on buffer
+ */
+void oled_draw_char5x8(int16_t x, int16_t y, char c)
+{
+  oled_draw_char_font(OLED_FONT_5X8, x, y, c);
+}
+
+/**
+ * @fn oled_print_5x8
+ * 
+ * @brief draw a text on the oled with font 5x8
+ * 
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text  text to display on the oled
+ */
+void oled_print_5x8(int16_t x, int16_t y, const char *text)
+{
+  if (!oled_text_visible(x, y, text, 6, 8))
+    return;
+
+  while (*text)
+  {
+    oled_draw_char5x8(x, y, *text++);
+    x += 6;
+  }
+}
+
+// every bit of a nibble repeated 2, 3 and 4 times, to scale glyph columns up
+static const uint8_t oled_scale2_nibble[16] = {
+    0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+    0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF,
+};
+static const uint16_t oled_scale3_nibble[16] = {
+    0x000, 0x007, 0x038, 0x03F, 0x1C0, 0x1C7, 0x1F8, 0x1FF,
+    0xE00, 0xE07, 0xE38, 0xE3F, 0xFC0, 0xFC7, 0xFF8, 0xFFF,
+};
+static const uint16_t oled_scale4_nibble[16] = {
+    0x0000, 0x000F, 0x00F0, 0x00FF, 0x0F00, 0x0F0F, 0x0FF0, 0x0FFF,
+    0xF000, 0xF00F, 0xF0F0, 0xF0FF, 0xFF00, 0xFF0F, 0xFFF0, 0xFFFF,
+};
+
+/**
+ * @fn oled_scale_column
+ * 
+ * @brief Scale a column byte up with the nibble tables
+ * 
+ * @param column column byte of the letter
+ * @param scale 2, 3 or 4
+ * 
+ * @return the column scaled, 8 * scale bits from the top
+ */
+static uint32_t oled_scale_column(uint8_t column, uint8_t scale)
+{
+  uint8_t lo = column & 0x0F;
+  uint8_t hi = column >> 4;
+
+  switch (scale)
+  {
+    case 2: return oled_scale2_nibble[lo] | ((uint32_t)oled_scale2_nibble[hi] << 8);
+    case 3: return oled_scale3_nibble[lo] | ((uint32_t)oled_scale3_nibble[hi] << 12);
+    case 4: return oled_scale4_nibble[lo] | ((uint32_t)oled_scale4_nibble[hi] << 16);
+  }
+  return column;
+}
+
+/**
+ * @fn oled_print_scaled
+ * 
+ * @brief draw a text with the given font scaled up, every letter is expanded to
+ * column bytes of 8 * scale rows and drawn as a bitmap
+ * 
+ * @param font font of the text
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text text to display on the oled
+ * @param scale 1 to 4
+ */
+static void oled_print_scaled(oled_font_t font, int16_t x, int16_t y, const char *text, uint8_t scale)
+{
+  if (scale == 0) scale = 1;
+  if (scale > 4) scale = 4;
+
+  int16_t advance = oled_font_advance(font) * scale;
+
+  if (!oled_text_visible(x, y, text, advance, 8 * scale))
+    return;
+
+  while (*text)
+  {
+    uint8_t columns[8];
+    uint8_t bitmap[4 * 8 * 4];
+    uint8_t width = oled_glyph_columns(font, *text++, columns);
+    uint8_t out_width = width * scale;
+
+    for (uint8_t i = 0; i < width; i++)
+    {
+      uint32_t scaled = oled_scale_column(columns[i], scale);
+
+      for (uint8_t page = 0; page < scale; page++)
+      {
+        uint8_t byte = scaled >> (8 * page);
+        for (uint8_t r = 0; r < scale; r++)
+        {
+          bitmap[page * out_width + i * scale + r] = byte;
+        }
+      }
+    }
+
+    oled_draw_bmp(x, y, out_width, 8 * scale, bitmap);
+    x += advance;
+  }
+}
+
+/**
+ * @fn oled_print_8x8_scaled
+ * 
+ * @brief draw a text on the oled with font 8x8 scaled up
+ * 
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text text to display on the oled
+ * @param scale 1 to 4
+ */
+void oled_print_8x8_scaled(int16_t x, int16_t y, const char *text, uint8_t scale)
+{
+  oled_print_scaled(OLED_FONT_8X8, x, y, text, scale);
+}
+
+/**
+ * @fn oled_print_6x8_scaled
+ * 
+ * @brief draw a text on the oled with font 6x8 scaled up
+ * 
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text text to display on the oled
+ * @param scale 1 to 4
+ */
+void oled_print_6x8_scaled(int16_t x, int16_t y, const char *text, uint8_t scale)
+{
+  oled_print_scaled(OLED_FONT_6X8, x, y, text, scale);
+}
+
+/**
+ * @fn oled_print_5x8_scaled
+ * 
+ * @brief draw a text on the oled with font 5x8 scaled up
+ * 
+ * @param x set position of the text on x
+ * @param y set position of the text on y
+ * @param text text to display on the oled
+ * @param scale 1 to 4
+ */
+void oled_print_5x8_scaled(int16_t x, int16_t y, const char *text, uint8_t scale)
+{
+  oled_print_scaled(OLED_FONT_5X8, x, y, text, scale);
+}
+
+/**
+ * @fn oled_num_field_init
+ * 
+ * @brief Set up a right aligned numeric field, the field remembers what it shows
+ * so the print functions only draw the characters that changed. Init it again
+ * after clearing the buffer so the whole field is drawn
+ * 
+ * @param field field to set up
+ * @param x position of the field on x
+ * @param y position of the field on y
+ * @param width number of characters of the field, up to OLED_NUM_MAX_WIDTH
+ * @param font font of the field
+ * @param flags OLED_NUM_ZERO_PAD to fill with leading zeros instead of blanks
+ */
+void oled_num_field_init(oled_num_field_t *field, int16_t x, int16_t y, uint8_t width, oled_font_t font, uint8_t flags)
+{
+  field->x = x;
+  field->y = y;
+  field->width = (width > OLED_NUM_MAX_WIDTH) ? OLED_NUM_MAX_WIDTH : width;
+  field->font = font;
+  field->flags = flags;
+  memset(field->last, 0, sizeof(field->last));
+}
+
+/**
+ * @fn oled_num_format
+ * 
+ * @brief Format a number right aligned into a fixed width, without libc
+ * 
+ * @param text output, exactly width characters and no terminator
+ * @param width number of characters
+ * @param value number to format, scaled by 10^decimals
+ * @param decimals digits after the decimal point
+ * @param zero_pad fill with leading zeros instead of blanks
+ * 
+ * @return false if the number does not fit in the width
+ */
+static bool oled_num_format(char *text, uint8_t width, int32_t value, uint8_t decimals, bool zero_pad)
+{
+  bool negative = value < 0;
+  uint32_t magnitude = negative ? 0u - (uint32_t)value : (uint32_t)value;
+  uint8_t pos = width;
+  uint8_t digits = 0;
+
+  // Digits from the right, at least one before the decimal point
+  do
+  {
+    if (decimals && digits == decimals)
+    {
+      if (pos == 0) return false;
+      text[--pos] = '.';
+    }
+    if (pos == 0) return false;
+    text[--pos] = '0' + (magnitude % 10);
+    magnitude /= 10;
+    digits++;
+  } while (magnitude || digits <= decimals);
+
+  if (zero_pad)
+  {
+    // The sign stays on the left of the zeros
+    uint8_t first = negative ? 1 : 0;
+    if (pos < first) return false;
+    while (pos > first) text[--pos] = '0';
+    if (negative) text[0] = '-';
+  }
+  else
+  {
+    if (negative)
+    {
+      if (pos == 0) return false;
+      text[--pos] = '-';
+    }
+    while (pos > 0) text[--pos] = ' ';
+  }
+
+  return true;
+}
+
+/**
+ * @fn oled_print_num
+ * 
+ * @brief Format a number into the field and draw only the characters that changed
+ * 
+ * @param field field to draw on
+ * @param value number to draw, scaled by 10^decimals
+ * @param decimals digits after the decimal point
+ */
+static void oled_print_num(oled_num_field_t *field, int32_t value, uint8_t decimals)
+{
+  char text[OLED_NUM_MAX_WIDTH];
+
+  if (!oled_num_format(text, field->width, value, decimals, field->flags & OLED_NUM_ZERO_PAD))
+  {
+    // Too big for the field
+    memset(text, '#', field->width);
+  }
+
+  int16_t x = field->x;
+  uint8_t advance = oled_font_advance(field->font);
+
+  for (uint8_t i = 0; i < field->width; i++)
+  {
+    if (text[i] != field->last[i])
+    {
+      oled_draw_char_font(field->font, x, field->y, text[i]);
+      field->last[i] = text[i];
+    }
+    x += advance;
+  }
+}
+
+/**
+ * @fn oled_print_int
+ * 
+ * @brief draw an integer right aligned in a numeric field, only the changed digits are drawn
+ * 
+ * @param field field to draw on
+ * @param value number to draw
+ */
+void oled_print_int(oled_num_field_t *field, int32_t value)
+{
+  oled_print_num(field, value, 0);
+}
+
+/**
+ * @fn oled_print_fixed
+ * 
+ * @brief draw a fixed point number right aligned in a numeric field, only the
+ * changed digits are drawn. For example value 1234 with 2 decimals is 12.34
+ * 
+ * @param field field to draw on
+ * @param value number to draw, scaled by 10^decimals
+ * @param decimals digits after the decimal point
+ */
+void oled_print_fixed(oled_num_field_t *field, int32_t value, uint8_t decimals)
+{
+  oled_print_num(field, value, decimals);
+}
+
+/**
+ * @fn oled_fill_columns
  *
- * @brief Draw a horizontal line
+ * @brief Fill a rectangle of the buffer, writing whole column bytes per page
  *
- * @param x starting x position
- * @param y position on y axis
- * @param length size of the line
+ * @param x starting column on the buffer
+ * @param y starting row on the buffer
+ * @param width rectangle width
+ * @param height rectangle height
  * @param color 0 = off, 1 = on
  */
-void oled_draw_hline(uint8_t x, uint8_t y, uint8_t length, uint8_t color)
+static void oled_fill_columns(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t color)
 {
-    if (y >= OLED_HEIGHT) return;
-    
-    if (x + length > OLED_WIDTH) {
-        length = OLED_WIDTH - x;
+    uint8_t last = y + height - 1;
+
+    for (uint8_t page = y >> 3; page <= (last >> 3); page++)
+    {
+        uint8_t top = (page == (y >> 3)) ? (y & 0x07) : 0;
+        uint8_t bottom = (page == (last >> 3)) ? (last & 0x07) : 7;
+        uint8_t mask = (uint8_t)(0xFF << top) & (uint8_t)(0xFF >> (7 - bottom));
+
+        for (uint8_t i = 0; i < width; i++)
+        {
+            if (color)
+                oled_buf[page][x + i] |= mask;
+            else
+                oled_buf[page][x + i] &= ~mask;
+        }
     }
+}
 
-    if (length == 0) return;
+/**
+ * @fn oled_map_rect
+ *
+ * @brief Move a visible rectangle of the rotated screen to buffer coordinates
+ *
+ * @param x starting x position, replaced by the starting column on the buffer
+ * @param y starting y position, replaced by the starting row on the buffer
+ * @param width rectangle width, replaced by the width on the buffer
+ * @param height rectangle height, replaced by the height on the buffer
+ */
+static void oled_map_rect(int16_t *x, int16_t *y, int16_t *width, int16_t *height)
+{
+    int16_t lx = *x, ly = *y, lw = *width, lh = *height;
 
-    for (uint8_t i = 0; i < length; i++)
+    if (oled_rotation == OLED_ROTATION_90)
+    {
+        *x = OLED_WIDTH - ly - lh;
+        *y = lx;
+        *width = lh;
+        *height = lw;
+    }
+    else if (oled_rotation == OLED_ROTATION_270)
     {
-        oled_set_pixel(x + i, y, color);
+        *x = ly;
+        *y = OLED_HEIGHT - lx - lw;
+        *width = lh;
+        *height = lw;
     }
 }
 
+/**
+ * @fn oled_fill_rect
+ *
+ * @brief Draw a filled rectangle
+ *
+ * @param x starting x position
+ * @param y starting y position
+ * @param width rectangle width
+ * @param height rectangle height
+ * @param color 0 = off, 1 = on
+ */
+void oled_fill_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color)
+{
+    if (!oled_clip_rect(&x, &y, &width, &height)) return;
+
+    oled_map_rect(&x, &y, &width, &height);
+    oled_fill_columns(x, y, width, height, color);
+}
+
+/**
+ * @fn oled_draw_hline
+ *
+ * @brief Draw a horizontal line
+ *
+ * @param x starting x position
+ * @param y position on y axis
+ * @param length size of the line
+ * @param color 0 = off, 1 = on
+ */
+void oled_draw_hline(int16_t x, int16_t y, int16_t length, uint8_t color)
+{
+    oled_fill_rect(x, y, length, 1, color);
+}
+
 /**
  * @fn oled_draw_vline
  *
@@ -508,19 +2259,9 @@ void oled_draw_hline(uint8_t x, uint8_t y, uint8_t length, uint8_t color)
  * @param length size of the line
  * @param color 0 = off, 1 = on
  */
-void oled_draw_vline(uint8_t x, uint8_t y, uint8_t length, uint8_t color)
+void oled_draw_vline(int16_t x, int16_t y, int16_t length, uint8_t color)
 {
-    if (x >= OLED_WIDTH) return;
-    
-    if (y + length > OLED_HEIGHT) {
-        length = OLED_HEIGHT - y;
-    }
-    if (length == 0) return;
-
-    for (uint8_t i = 0; i < length; i++)
-    {
-        oled_set_pixel(x, y + i, color);
-    }
+    oled_fill_rect(x, y, 1, length, color);
 }
 
 /**
@@ -534,9 +2275,10 @@ void oled_draw_vline(uint8_t x, uint8_t y, uint8_t length, uint8_t color)
  * @param height rectangle height
  * @param color 0 = off, 1 = on
  */
-void oled_draw_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t color)
+void oled_draw_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color)
 {
-    if (width <= 0 || height <= 0)
+    int16_t vx = x, vy = y, vw = width, vh = height;
+    if (!oled_clip_rect(&vx, &vy, &vw, &vh))
         return;
 
     // Top
@@ -550,4 +2292,268 @@ void oled_draw_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t
 
     // Right
     oled_draw_vline(x + width - 1, y, height, color);
-}
\ No newline at end of file
+}
+
+/**
+ * @fn oled_mark_dirty
+ *
+ * @brief Mark a rectangle as changed, so oled_flush_dirty() sends it
+ *
+ * @param x starting x position
+ * @param y starting y position
+ * @param width rectangle width
+ * @param height rectangle height
+ */
+void oled_mark_dirty(int16_t x, int16_t y, int16_t width, int16_t height)
+{
+    if (!oled_clip_rect(&x, &y, &width, &height)) return;
+
+    oled_map_rect(&x, &y, &width, &height);
+    oled_mark_dirty_columns(x, y, width, height);
+}
+
+/**
+ * @fn oled_chart_row
+ *
+ * @brief Row of the plot where a sample is drawn, the top row is 0
+ *
+ * @param chart chart of the sample
+ * @param sample value of the sample
+ *
+ * @return row of the sample, clamped to the plot
+ */
+static uint8_t oled_chart_row(const oled_chart_t *chart, int16_t sample)
+{
+    int32_t rows = chart->pages * 8 - 1;
+
+    if (sample <= chart->min) return rows;
+    if (sample >= chart->max) return 0;
+
+    return rows - ((int32_t)(sample - chart->min) * rows) / (chart->max - chart->min);
+}
+
+/**
+ * @fn oled_chart_column
+ *
+ * @brief Draw one column of the plot as whole bytes, a vertical span joining the
+ * previous sample with the new one so fast changes stay connected
+ *
+ * @param chart chart to draw on
+ * @param col column on the buffer
+ * @param from row of the previous sample
+ * @param to row of the new sample
+ */
+static void oled_chart_column(const oled_chart_t *chart, uint8_t col, uint8_t from, uint8_t to)
+{
+    uint8_t top = (from < to) ? from : to;
+    uint8_t bottom = (from < to) ? to : from;
+
+    for (uint8_t p = 0; p < chart->pages; p++)
+    {
+        uint8_t byte = 0;
+        int16_t first = top - p * 8;
+        int16_t last = bottom - p * 8;
+
+        if (last >= 0 && first <= 7)
+        {
+            if (first < 0) first = 0;
+            if (last > 7) last = 7;
+            byte = (uint8_t)(0xFF << first) & (uint8_t)(0xFF >> (7 - last));
+        }
+        oled_buf[chart->page + p][col] = byte;
+    }
+}
+
+/**
+ * @fn oled_chart_init
+ *
+ * @brief Set up a scrolling strip chart on the unrotated buffer. The plot is
+ * page aligned so it can scroll by moving whole bytes, and it keeps one sample
+ * per column in the caller's ring buffer
+ *
+ * @param chart chart to set up
+ * @param x left column of the plot
+ * @param page top page of the plot
+ * @param width columns of the plot
+ * @param pages height of the plot in pages
+ * @param min sample value drawn at the bottom
+ * @param max sample value drawn at the top
+ * @param samples ring buffer of width samples
+ */
+void oled_chart_init(oled_chart_t *chart, uint8_t x, uint8_t page, uint8_t width, uint8_t pages,
+                     int16_t min, int16_t max, int16_t *samples)
+{
+    if (x >= OLED_WIDTH || page >= OLED_NUM_PAGES) width = 0;
+    else if (x + width > OLED_WIDTH) width = OLED_WIDTH - x;
+    if (page + pages > OLED_NUM_PAGES) pages = (page < OLED_NUM_PAGES) ? OLED_NUM_PAGES - page : 0;
+
+    chart->x = x;
+    chart->page = page;
+    chart->width = width;
+    chart->pages = pages;
+    chart->min = min;
+    chart->max = (max > min) ? max : min + 1;
+    chart->samples = samples;
+    chart->head = 0;
+    chart->count = 0;
+}
+
+/**
+ * @fn oled_chart_push
+ *
+ * @brief Add a sample, the plot moves one column to the left and only the new
+ * column is drawn. The plot area is marked for oled_flush_dirty()
+ *
+ * @param chart chart to draw on
+ * @param sample new sample
+ */
+void oled_chart_push(oled_chart_t *chart, int16_t sample)
+{
+    if (chart->width == 0 || chart->pages == 0) return;
+
+    uint8_t last_col = chart->x + chart->width - 1;
+    uint8_t row = oled_chart_row(chart, sample);
+    uint8_t prev = row;
+
+    if (chart->count)
+    {
+        uint8_t newest = (chart->head + chart->width - 1) % chart->width;
+        prev = oled_chart_row(chart, chart->samples[newest]);
+    }
+
+    chart->samples[chart->head] = sample;
+    chart->head = (chart->head + 1) % chart->width;
+    if (chart->count < chart->width) chart->count++;
+
+    for (uint8_t p = 0; p < chart->pages; p++)
+    {
+        memmove(&oled_buf[chart->page + p][chart->x], &oled_buf[chart->page + p][chart->x + 1], chart->width - 1);
+    }
+    oled_chart_column(chart, last_col, prev, row);
+
+    oled_mark_dirty_columns(chart->x, chart->page * 8, chart->width, chart->pages * 8);
+}
+
+/**
+ * @fn oled_chart_redraw
+ *
+ * @brief Draw the whole plot again from the stored samples, after the buffer was cleared
+ *
+ * @param chart chart to draw
+ */
+void oled_chart_redraw(oled_chart_t *chart)
+{
+    if (chart->width == 0 || chart->pages == 0) return;
+
+    for (uint8_t p = 0; p < chart->pages; p++)
+    {
+        memset(&oled_buf[chart->page + p][chart->x], 0x00, chart->width);
+    }
+    oled_mark_dirty_columns(chart->x, chart->page * 8, chart->width, chart->pages * 8);
+
+    if (chart->count == 0) return;
+
+    uint8_t col = chart->x + chart->width - chart->count;
+    uint8_t index = (chart->head + chart->width - chart->count) % chart->width;
+    uint8_t prev = oled_chart_row(chart, chart->samples[index]);
+
+    for (uint8_t i = 0; i < chart->count; i++)
+    {
+        uint8_t row = oled_chart_row(chart, chart->samples[index]);
+        oled_chart_column(chart, col++, prev, row);
+        prev = row;
+        index = (index + 1) % chart->width;
+    }
+}
+
+#endif
+
+/**
+ * @fn oled_direct_write
+ *
+ * @brief Write column bytes straight to the display RAM of a page, in one transaction
+ *
+ * @param x first column to write
+ * @param page page to write
+ * @param data column bytes
+ * @param count number of columns, cut at the right edge
+ */
+static void oled_direct_write(uint8_t x, uint8_t page, const uint8_t *data, uint8_t count)
+{
+    if (x >= OLED_WIDTH || page >= OLED_NUM_PAGES || count == 0) return;
+
+    if (x + count > OLED_WIDTH) {
+        count = OLED_WIDTH - x;
+    }
+
+    uint8_t buffer[OLED_DIRECT_HEADER_MAX + OLED_WIDTH];
+    uint8_t len = oled_direct_header(buffer, x, page, count);
+
+    memcpy(&buffer[len], data, count);
+    i2c_master_transmit(i2c_dev_handle, buffer, len + count, I2C_TICKS_TO_WAIT);
+}
+
+/**
+ * @fn oled_direct_print
+ *
+ * @brief Write a text straight to the display, without the buffer. The whole
+ * line goes in one transaction, only the columns of the text are sent
+ *
+ * @param font font of the text
+ * @param x set position of the text on x
+ * @param page page of the text (y / 8)
+ * @param text text to display on the oled
+ */
+void oled_direct_print(oled_font_t font, uint8_t x, uint8_t page, const char *text)
+{
+    uint8_t columns[OLED_WIDTH];
+    uint8_t count = 0;
+    uint8_t advance = oled_font_advance(font);
+
+    while (*text && x + count < OLED_WIDTH)
+    {
+        uint8_t glyph[8];
+        uint8_t width = oled_glyph_columns(font, *text++, glyph);
+
+        for (uint8_t i = 0; i < advance && x + count < OLED_WIDTH; i++)
+        {
+            columns[count++] = (i < width) ? glyph[i] : 0x00;
+        }
+    }
+
+    oled_direct_write(x, page, columns, count);
+}
+
+/**
+ * @fn oled_direct_draw_bmp
+ *
+ * @brief Write a page aligned bitmap straight to the display, one transaction per page
+ *
+ * @param x set position on x axe on the oled
+ * @param page first page of the bitmap (y / 8)
+ * @param w width of the bitmap
+ * @param pages height of the bitmap in pages
+ * @param bitmap the array of the bitmap, same layout as oled_draw_bmp()
+ */
+void oled_direct_draw_bmp(uint8_t x, uint8_t page, uint8_t w, uint8_t pages, const uint8_t *bitmap)
+{
+    for (uint8_t p = 0; p < pages; p++)
+    {
+        oled_direct_write(x, page + p, &bitmap[p * w], w);
+    }
+}
+
+/**
+ * @fn oled_direct_clear
+ *
+ * @brief Clear the display RAM without the buffer
+ *
+ * @param none
+ */
+void oled_direct_clear(void)
+{
+    for (uint8_t p = 0; p < OLED_NUM_PAGES; p++)
+    {
+        oled_direct_write(0, p, oled_blank_page, OLED_WIDTH);
+    }
+}